@@ -15,7 +15,7 @@
           name = "vbeterm";
           src = ./.;
           nativeBuildInputs = with pkgs; [ autoreconfHook pkg-config ];
-          buildInputs = [ pkgs.vte ];
+          buildInputs = with pkgs; [ vte pcre2 zstd ];
           postInstall = ''
             mv $out/bin/term $out/bin/${name}
           '';
@@ -0,0 +1,442 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Each window gets its own cgroup v2 for its child. When a systemd user
+ * manager is available, the command is run through "systemd-run --scope"
+ * which creates a transient scope before executing it. Otherwise,
+ * if our own cgroup has been delegated to us, we manage a cgroup for each
+ * window directly below it. */
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+/* Delay between attempts to configure a scope not created yet (in ms) */
+#define CGROUP_RETRY_DELAY 100
+/* Maximum number of attempts */
+#define CGROUP_RETRIES 50
+
+static enum {
+	CGROUP_UNKNOWN,
+	CGROUP_NONE,
+	CGROUP_SYSTEMD,
+	CGROUP_DIRECT
+} mode = CGROUP_UNKNOWN;
+static GDBusConnection *bus = NULL;	/* Session bus (systemd mode) */
+static char *base = NULL;	/* Delegated cgroup (direct mode) */
+
+/* Per-window state */
+struct cgroup {
+	GtkWindow *window;
+	char *name;		/* Scope unit name or cgroup directory */
+	char *procs;		/* cgroup.procs file (direct mode) */
+	gint cpu_weight;	/* Base CPU weight */
+	guint64 memory_max;	/* Memory limit (0 = unlimited) */
+	gboolean focused;
+	gboolean attached;	/* Child is running in the cgroup */
+	guint64 weight;		/* Last CPU weight set */
+	guint retry;		/* Pending attempt (systemd mode) */
+	guint retries;
+};
+
+static gboolean
+write_file(const char *path, const char *value)
+{
+	/* Also used from the child before exec: stay async-signal-safe. */
+	int fd;
+	ssize_t len = strlen(value);
+	if ((fd = open(path, O_WRONLY | O_CLOEXEC)) == -1)
+		return FALSE;
+	gboolean ok = (write(fd, value, len) == len);
+	close(fd);
+	return ok;
+}
+
+static gboolean
+write_cgroup_file(const char *cgroup, const char *file, const char *value)
+{
+	char *path = g_build_filename(cgroup, file, NULL);
+	gboolean ok = write_file(path, value);
+	if (!ok)
+		g_warning("cannot write %s to %s: %s", value, path, strerror(errno));
+	g_free(path);
+	return ok;
+}
+
+/* Get the path to our own cgroup */
+static char *
+own_cgroup(void)
+{
+	gchar *contents = NULL;
+	char *result = NULL;
+	if (!g_file_get_contents("/proc/self/cgroup", &contents, NULL, NULL))
+		return NULL;
+
+	/* cgroup v2 only exposes the unified "0::" hierarchy */
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	for (gchar **line = lines; *line != NULL; line++) {
+		if (g_str_has_prefix(*line, "0::")) {
+			result = g_build_filename(CGROUP_ROOT, *line + 3, NULL);
+			break;
+		}
+	}
+	g_strfreev(lines);
+	g_free(contents);
+	return result;
+}
+
+static gboolean
+systemd_available(void)
+{
+	GVariant *reply;
+	gboolean owned = FALSE;
+	char *run = g_find_program_in_path("systemd-run");
+	if (run == NULL)
+		return FALSE;
+	g_free(run);
+	if ((bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL)) == NULL)
+		return FALSE;
+	reply = g_dbus_connection_call_sync(bus,
+	    "org.freedesktop.DBus", "/org/freedesktop/DBus",
+	    "org.freedesktop.DBus", "NameHasOwner",
+	    g_variant_new("(s)", "org.freedesktop.systemd1"),
+	    G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE,
+	    -1, NULL, NULL);
+	if (reply != NULL) {
+		g_variant_get(reply, "(b)", &owned);
+		g_variant_unref(reply);
+	}
+	if (!owned)
+		g_clear_object(&bus);
+	return owned;
+}
+
+/* Are the cpu and memory controllers available to the provided cgroup? */
+static gboolean
+controllers_available(const char *cgroup)
+{
+	gchar *contents = NULL;
+	gboolean cpu = FALSE, memory = FALSE;
+	char *path = g_build_filename(cgroup, "cgroup.controllers", NULL);
+	if (g_file_get_contents(path, &contents, NULL, NULL)) {
+		gchar **names = g_strsplit_set(g_strstrip(contents), " ", -1);
+		for (gchar **name = names; *name != NULL; name++) {
+			cpu |= !strcmp(*name, "cpu");
+			memory |= !strcmp(*name, "memory");
+		}
+		g_strfreev(names);
+	}
+	g_free(contents);
+	g_free(path);
+	return cpu && memory;
+}
+
+static gboolean
+delegation_available(void)
+{
+	char *self, *leaf = NULL, *subtree = NULL;
+	char pid[16];
+	gboolean ok = FALSE;
+
+	if ((self = own_cgroup()) == NULL)
+		return FALSE;
+	subtree = g_build_filename(self, "cgroup.subtree_control", NULL);
+	if (access(subtree, W_OK) == -1 || !controllers_available(self))
+		goto end;
+
+	/* A cgroup with processes cannot distribute resources to its
+	 * children. Move ourselves into a leaf first. */
+	leaf = g_build_filename(self, "terminal", NULL);
+	if (mkdir(leaf, 0755) == -1 && errno != EEXIST)
+		goto end;
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	if (!write_cgroup_file(leaf, "cgroup.procs", pid))
+		goto end;
+	if (!write_file(subtree, "+cpu +memory")) {
+		g_warning("cannot enable controllers in %s: %s", self, strerror(errno));
+		write_cgroup_file(self, "cgroup.procs", pid);
+		goto end;
+	}
+
+	base = self;
+	self = NULL;
+	ok = TRUE;
+end:
+	g_free(self);
+	g_free(leaf);
+	g_free(subtree);
+	return ok;
+}
+
+static void
+cgroup_detect(void)
+{
+	if (mode != CGROUP_UNKNOWN) return;
+	if (systemd_available())
+		mode = CGROUP_SYSTEMD;
+	else if (delegation_available())
+		mode = CGROUP_DIRECT;
+	else {
+		g_warning("no systemd user manager nor delegated cgroup, "
+		    "child resources won't be isolated");
+		mode = CGROUP_NONE;
+	}
+}
+
+static void
+cgroup_free(struct cgroup *cg)
+{
+	if (cg == NULL) return;
+	if (cg->retry != 0)
+		g_source_remove(cg->retry);
+	/* Fails if some descendants are still alive, nothing to do then. */
+	if (mode == CGROUP_DIRECT && cg->name != NULL)
+		rmdir(cg->name);
+	g_free(cg->name);
+	g_free(cg->procs);
+	g_free(cg);
+}
+
+static void cgroup_set_cpu_weight(struct cgroup *);
+
+static gboolean
+cgroup_retry(gpointer user_data)
+{
+	struct cgroup *cg = user_data;
+	wakeup_dispatch("cgroup");
+	cg->retry = 0;
+	cgroup_set_cpu_weight(cg);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+on_dbus_reply(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GtkWindow *window = user_data;
+	struct cgroup *cg = g_object_get_data(G_OBJECT(window), "cgroup");
+	GError *error = NULL;
+	GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source),
+	    res, &error);
+	if (reply != NULL) {
+		g_variant_unref(reply);
+		if (cg != NULL) cg->retries = 0;
+		goto end;
+	}
+	if (cg == NULL) {
+		g_error_free(error);
+		goto end;
+	}
+
+	/* systemd-run may not have created the scope yet. Retry until it
+	 * does. */
+	gchar *remote = g_dbus_error_get_remote_error(error);
+	cg->weight = 0;
+	if (!g_strcmp0(remote, "org.freedesktop.systemd1.NoSuchUnit") &&
+	    cg->retries < CGROUP_RETRIES) {
+		cg->retries++;
+		if (cg->retry == 0)
+			cg->retry = g_timeout_add(CGROUP_RETRY_DELAY,
+			    cgroup_retry, cg);
+	} else
+		g_warning("cannot configure %s: %s", cg->name, error->message);
+	g_free(remote);
+	g_error_free(error);
+end:
+	g_object_unref(window);
+}
+
+/* CPU weight depending on focus */
+static guint64
+cgroup_cpu_weight(struct cgroup *cg)
+{
+	return cg->focused ?
+	    MIN(cg->cpu_weight * 2, 10000) :
+	    MAX(cg->cpu_weight / 2, 1);
+}
+
+static void
+cgroup_set_cpu_weight(struct cgroup *cg)
+{
+	guint64 weight = cgroup_cpu_weight(cg);
+	if (!cg->attached || cg->retry != 0 || weight == cg->weight) return;
+	cg->weight = weight;
+	switch (mode) {
+	case CGROUP_SYSTEMD: {
+		GVariantBuilder props;
+		g_variant_builder_init(&props, G_VARIANT_TYPE("a(sv)"));
+		g_variant_builder_add(&props, "(sv)", "CPUWeight",
+		    g_variant_new_uint64(weight));
+		g_dbus_connection_call(bus,
+		    "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+		    "org.freedesktop.systemd1.Manager", "SetUnitProperties",
+		    g_variant_new("(sba(sv))", cg->name, TRUE, &props),
+		    NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+		    on_dbus_reply, g_object_ref(cg->window));
+		break;
+	}
+	case CGROUP_DIRECT: {
+		char value[32];
+		snprintf(value, sizeof(value), "%" G_GUINT64_FORMAT, weight);
+		write_cgroup_file(cg->name, "cpu.weight", value);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/* Parse a memory size, with an optional K, M or G suffix. */
+gboolean
+cgroup_parse_size(const gchar *spec, guint64 *size)
+{
+	gchar *end;
+	guint64 multiplier = 1;
+	errno = 0;
+	guint64 value = g_ascii_strtoull(spec, &end, 10);
+	if (end == spec || errno == ERANGE) return FALSE;
+	switch (g_ascii_toupper(*end)) {
+	case 'G': multiplier *= 1024;	/* fallthrough */
+	case 'M': multiplier *= 1024;	/* fallthrough */
+	case 'K': multiplier *= 1024; end++;	/* fallthrough */
+	case '\0': break;
+	default: return FALSE;
+	}
+	if (*end != '\0' || value > G_MAXUINT64 / multiplier) return FALSE;
+	*size = value * multiplier;
+	return TRUE;
+}
+
+/* Prepare a cgroup for the child of the provided window. Returns FALSE if
+ * the child won't be isolated. */
+gboolean
+cgroup_new(GtkWindow *window, gint cpu_weight, guint64 memory_max)
+{
+	static guint count = 0;
+	struct cgroup *cg;
+
+	cgroup_detect();
+	if (mode == CGROUP_NONE) return FALSE;
+
+	cg = g_new0(struct cgroup, 1);
+	cg->window = window;
+	cg->cpu_weight = CLAMP(cpu_weight, 1, 10000);
+	cg->memory_max = memory_max;
+	if (mode == CGROUP_SYSTEMD)
+		cg->name = g_strdup_printf("%s-%d-%u.scope", PACKAGE_NAME,
+		    getpid(), count++);
+	if (mode == CGROUP_DIRECT) {
+		/* Create the cgroup now so that the child can move itself
+		 * into it before running anything. */
+		char value[32];
+		char *name = g_strdup_printf("window-%d-%u", getpid(), count++);
+		cg->name = g_build_filename(base, name, NULL);
+		cg->procs = g_build_filename(cg->name, "cgroup.procs", NULL);
+		g_free(name);
+		if (mkdir(cg->name, 0755) == -1) {
+			/* Never take over a leftover cgroup */
+			g_warning("cannot create %s: %s", cg->name, strerror(errno));
+			g_clear_pointer(&cg->name, g_free);
+			cgroup_free(cg);
+			return FALSE;
+		}
+		cg->attached = TRUE;
+		cgroup_set_cpu_weight(cg);
+		if (memory_max > 0) {
+			snprintf(value, sizeof(value), "%" G_GUINT64_FORMAT, memory_max);
+			write_cgroup_file(cg->name, "memory.max", value);
+		}
+	}
+	g_object_set_data_full(G_OBJECT(window), "cgroup", cg,
+	    (GDestroyNotify)cgroup_free);
+	return TRUE;
+}
+
+/* Child setup function for vte_terminal_spawn_async(). Runs in the child
+ * between fork and exec. */
+void
+cgroup_child_setup(gpointer user_data)
+{
+	struct cgroup *cg = user_data;
+	if (cg == NULL || cg->procs == NULL) return;
+	write_file(cg->procs, "0");
+}
+
+/* Get the data for cgroup_child_setup() */
+gpointer
+cgroup_child_data(GtkWindow *window)
+{
+	return g_object_get_data(G_OBJECT(window), "cgroup");
+}
+
+/* Wrap the command to run it in a systemd scope. Returns NULL if the
+ * command does not need to be wrapped. */
+gchar **
+cgroup_command(GtkWindow *window, gchar **command)
+{
+	struct cgroup *cg = g_object_get_data(G_OBJECT(window), "cgroup");
+	if (cg == NULL || mode != CGROUP_SYSTEMD) return NULL;
+
+	GPtrArray *args = g_ptr_array_new();
+	cg->weight = cgroup_cpu_weight(cg);
+	g_ptr_array_add(args, g_strdup("systemd-run"));
+	g_ptr_array_add(args, g_strdup("--user"));
+	g_ptr_array_add(args, g_strdup("--scope"));
+	g_ptr_array_add(args, g_strdup("--quiet"));
+	g_ptr_array_add(args, g_strdup("--collect"));
+	g_ptr_array_add(args, g_strdup_printf("--unit=%s", cg->name));
+	g_ptr_array_add(args, g_strdup_printf("--property=CPUWeight=%" G_GUINT64_FORMAT,
+		cg->weight));
+	if (cg->memory_max > 0)
+		g_ptr_array_add(args, g_strdup_printf("--property=MemoryMax=%" G_GUINT64_FORMAT,
+			cg->memory_max));
+	g_ptr_array_add(args, g_strdup("--"));
+	for (gchar **arg = command; *arg != NULL; arg++)
+		g_ptr_array_add(args, g_strdup(*arg));
+	g_ptr_array_add(args, NULL);
+	return (gchar **)g_ptr_array_free(args, FALSE);
+}
+
+/* The child of the provided window has been spawned. */
+void
+cgroup_attach(GtkWindow *window, GPid pid)
+{
+	struct cgroup *cg = g_object_get_data(G_OBJECT(window), "cgroup");
+	if (cg == NULL || mode != CGROUP_SYSTEMD) return;
+
+	/* Apply focus changes that happened while spawning. If systemd-run
+	 * has not created the scope yet, this is retried until it has. */
+	cg->attached = TRUE;
+	cgroup_set_cpu_weight(cg);
+}
+
+/* Boost the CPU weight of the focused window and reduce the weight of the
+ * other ones. */
+void
+cgroup_focus(GtkWindow *window, gboolean focused)
+{
+	struct cgroup *cg = g_object_get_data(G_OBJECT(window), "cgroup");
+	if (cg == NULL || cg->focused == focused) return;
+	cg->focused = focused;
+	cgroup_set_cpu_weight(cg);
+}
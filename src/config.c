@@ -0,0 +1,329 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The configuration file is a key file. Once parsed, the result is
+ * written to a cache file stamped with the identity of the configuration
+ * file and of the build. On next start, if the stamp matches, the cache is
+ * mapped and used as is. */
+
+#define CONFIG_GROUP "terminal"
+#define CONFIG_MAGIC 0x43544256	/* VBTC */
+#define CONFIG_VERSION 3
+/* Delay before applying a modified configuration (in ms) */
+#define CONFIG_RELOAD_DELAY 100
+
+struct config_cache {
+	guint32 magic;
+	guint32 version;
+	guint32 size;		/* Size of this structure */
+	guint32 defaults;	/* Hash of the defaults */
+	guint64 dev;		/* Identity of the configuration file */
+	guint64 ino;
+	guint64 mtime;		/* In ns */
+	guint64 file_size;
+	char build[32];		/* PACKAGE_VERSION */
+	struct term_config config;
+};
+
+static const struct term_config defaults = {
+	.font = TERM_FONT,
+	.word_chars = TERM_WORD_CHARS,
+	.opacity = TERM_OPACITY,
+	.dabbrev_min_prefix = TERM_DABBREV_MIN_PREFIX,
+	.history_size = TERM_HISTORY_SIZE,
+	.foreground = 0xffffff,
+	.background = 0x0c0000,
+	.cursor = 0x00bb00,
+	.palette = {
+		0x111111, 0xd36265, 0xaece91, 0xe7e18c,
+		0x5297cf, 0xde7fa8, 0x5e7175, 0xbebebe,
+		0x555555, 0xef8171, 0xcfefb3, 0xfff796,
+		0x74b8ef, 0xe393b6, 0xa3babf, 0xdddddd,
+	},
+};
+
+static const struct term_config *current = &defaults;
+static struct config_cache *mapped = NULL;	/* Mapped cache */
+static struct config_cache *parsed = NULL;	/* Parsed configuration, not mapped */
+static GFileMonitor *monitor = NULL;
+static guint reload_source = 0;
+
+/* FNV-1a hash of the defaults (padding is zero as they are static) */
+static guint32
+config_defaults_hash(void)
+{
+	const guint8 *p = (const guint8 *)&defaults;
+	guint32 h = 2166136261u;
+	for (gsize i = 0; i < sizeof(defaults); i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static char *
+config_path(void)
+{
+	return g_build_filename(g_get_user_config_dir(), PACKAGE_NAME, "config", NULL);
+}
+
+static char *
+config_cache_path(void)
+{
+	return g_build_filename(g_get_user_cache_dir(), PACKAGE_NAME, "config.bin", NULL);
+}
+
+static void
+config_release(void)
+{
+	if (mapped != NULL) {
+		munmap(mapped, sizeof(*mapped));
+		mapped = NULL;
+	}
+	g_free(parsed);
+	parsed = NULL;
+	current = &defaults;
+}
+
+/* Map the cache if it matches the provided stamp */
+static gboolean
+config_map(const char *path, const struct config_cache *stamp)
+{
+	int fd;
+	struct stat st;
+	struct config_cache *cache;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return FALSE;
+	if (fstat(fd, &st) == -1 || st.st_size != sizeof(*cache)) {
+		close(fd);
+		return FALSE;
+	}
+	cache = mmap(NULL, sizeof(*cache), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (cache == MAP_FAILED)
+		return FALSE;
+	if (memcmp(cache, stamp, offsetof(struct config_cache, config))) {
+		munmap(cache, sizeof(*cache));
+		return FALSE;
+	}
+	mapped = cache;
+	current = &cache->config;
+	return TRUE;
+}
+
+static gboolean
+parse_color(GKeyFile *file, const char *key, guint32 *color)
+{
+	gchar *value = g_key_file_get_string(file, CONFIG_GROUP, key, NULL);
+	gboolean ok = FALSE;
+	if (value == NULL) return TRUE;
+	g_strstrip(value);
+	if (value[0] == '#' && strlen(value) == 7) {
+		ok = TRUE;
+		for (int i = 1; i < 7; i++)
+			ok &= g_ascii_isxdigit(value[i]);
+		if (ok)
+			*color = g_ascii_strtoull(value + 1, NULL, 16);
+	}
+	if (!ok)
+		g_warning("invalid color for %s: %s", key, value);
+	g_free(value);
+	return ok;
+}
+
+static void
+parse_integer(GKeyFile *file, const char *key, guint *dst)
+{
+	GError *error = NULL;
+	gint value;
+	if (!g_key_file_has_key(file, CONFIG_GROUP, key, NULL)) return;
+	value = g_key_file_get_integer(file, CONFIG_GROUP, key, &error);
+	if (error != NULL) {
+		g_warning("invalid value for %s: %s", key, error->message);
+		g_error_free(error);
+		return;
+	}
+	if (value < 0) {
+		g_warning("invalid value for %s: %d", key, value);
+		return;
+	}
+	*dst = value;
+}
+
+static void
+parse_string(GKeyFile *file, const char *key, char *dst, gsize len)
+{
+	gchar *value = g_key_file_get_string(file, CONFIG_GROUP, key, NULL);
+	if (value == NULL) return;
+	if (g_strlcpy(dst, value, len) >= len)
+		g_warning("value for %s is too long, truncated", key);
+	g_free(value);
+}
+
+/* Parse the configuration file. Returns FALSE if it cannot be loaded. */
+static gboolean
+config_parse(const char *path, struct term_config *config)
+{
+	GKeyFile *file = g_key_file_new();
+	GError *error = NULL;
+	if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, &error)) {
+		g_warning("cannot load %s: %s", path, error->message);
+		g_error_free(error);
+		g_key_file_free(file);
+		return FALSE;
+	}
+
+	parse_string(file, "font", config->font, sizeof(config->font));
+	parse_string(file, "word-chars", config->word_chars, sizeof(config->word_chars));
+	if (g_key_file_has_key(file, CONFIG_GROUP, "opacity", NULL)) {
+		double opacity = g_key_file_get_double(file,
+		    CONFIG_GROUP, "opacity", &error);
+		if (error != NULL) {
+			g_warning("invalid value for opacity: %s", error->message);
+			g_clear_error(&error);
+		} else
+			config->opacity = CLAMP(opacity, 0., 1.);
+	}
+	parse_integer(file, "dabbrev-min-prefix", &config->dabbrev_min_prefix);
+	parse_integer(file, "history-size", &config->history_size);
+	parse_color(file, "foreground", &config->foreground);
+	parse_color(file, "background", &config->background);
+	parse_color(file, "cursor", &config->cursor);
+	for (int i = 0; i < 16; i++) {
+		char key[16];
+		g_snprintf(key, sizeof(key), "color%d", i);
+		parse_color(file, key, &config->palette[i]);
+	}
+	g_key_file_free(file);
+	return TRUE;
+}
+
+static void
+config_load(void)
+{
+	struct stat st;
+	struct config_cache stamp = {
+		.magic = CONFIG_MAGIC,
+		.version = CONFIG_VERSION,
+		.size = sizeof(struct config_cache),
+		.defaults = config_defaults_hash(),
+		.build = PACKAGE_VERSION,
+	};
+	char *path = config_path();
+	char *cache_path = config_cache_path();
+
+	config_release();
+	if (stat(path, &st) == -1)
+		goto end;	/* Use defaults */
+	stamp.dev = st.st_dev;
+	stamp.ino = st.st_ino;
+	stamp.mtime = st.st_mtim.tv_sec * G_GUINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+	stamp.file_size = st.st_size;
+	if (config_map(cache_path, &stamp))
+		goto end;
+
+	/* Parse and save for next time */
+	parsed = g_new0(struct config_cache, 1);
+	memcpy(parsed, &stamp, offsetof(struct config_cache, config));
+	memcpy(&parsed->config, &defaults, sizeof(defaults));
+	current = &parsed->config;
+	if (!config_parse(path, &parsed->config))
+		goto end;	/* Warn again next time */
+
+	char *cache_dir = g_path_get_dirname(cache_path);
+	g_mkdir_with_parents(cache_dir, 0700);
+	g_free(cache_dir);
+	g_file_set_contents(cache_path, (const gchar *)parsed, sizeof(*parsed), NULL);
+end:
+	g_free(path);
+	g_free(cache_path);
+}
+
+static gboolean
+config_reload(gpointer user_data)
+{
+	GtkApplication *app = user_data;
+	char font[sizeof(current->font)];
+	reload_source = 0;
+	wakeup_dispatch("config");
+	g_strlcpy(font, current->font, sizeof(font));
+	config_load();
+
+	/* Keep the zoom level of each terminal if the font did not change */
+	gboolean reset_font = strcmp(font, current->font) != 0;
+
+	/* Apply to all terminals in one pass */
+	for (GList *windows = gtk_application_get_windows(app);
+	     windows;
+	     windows = windows->next) {
+		VteTerminal *terminal = g_object_get_data(G_OBJECT(windows->data),
+		    "terminal");
+		if (terminal == NULL) continue;
+		terminal_configure(terminal, reset_font);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void
+on_config_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+    GFileMonitorEvent event, gpointer user_data)
+{
+	/* Editors usually trigger several events. */
+	if (reload_source == 0)
+		reload_source = g_timeout_add(CONFIG_RELOAD_DELAY,
+		    config_reload, user_data);
+}
+
+/* Load configuration and watch for changes. */
+void
+config_init(GApplication *app, gpointer user_data)
+{
+	config_load();
+
+	/* Without the directory, GLib would poll for it. */
+	char *path = config_path();
+	char *dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+	GFile *file = g_file_new_for_path(path);
+	GError *error = NULL;
+	if ((monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE,
+		    NULL, &error)) == NULL) {
+		g_warning("cannot watch %s: %s", path, error->message);
+		g_error_free(error);
+	} else
+		g_signal_connect(monitor, "changed",
+		    G_CALLBACK(on_config_changed), app);
+	g_object_unref(file);
+	g_free(path);
+}
+
+/* Current configuration. Do not keep the returned pointer around. */
+const struct term_config *
+config_get(void)
+{
+	return current;
+}
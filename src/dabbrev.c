@@ -45,23 +45,32 @@ static gboolean
 is_word_char(const char c)
 {
 	if (isalnum(c)) return TRUE;
-	if (strchr(TERM_WORD_CHARS, c)) return TRUE;
+	if (strchr(config_get()->word_chars, c)) return TRUE;
 	return FALSE;
 }
 
 #define DEL "\x7f"
 
 static char *
-append_corpus(VteTerminal *terminal, char *corpus)
+append_text(char *corpus, char *text)
 {
-	char *text = vte_terminal_get_text_format(terminal, VTE_FORMAT_TEXT);
 	if (corpus == NULL) return text;
+	if (text == NULL) return corpus;
 
 	char *new_corpus = g_strdup_printf("%s %s", corpus, text);
 	free(corpus); free(text);
 	return new_corpus;
 }
 
+static char *
+append_corpus(VteTerminal *terminal, const char *prefix, char *corpus)
+{
+	/* Only the history blocks which may contain the prefix */
+	corpus = append_text(corpus, history_text(terminal, prefix));
+	return append_text(corpus,
+	    vte_terminal_get_text_format(terminal, VTE_FORMAT_TEXT));
+}
+
 static void
 update_corpus(GtkWindow *window, VteTerminal *terminal, struct dabbrev_state *state)
 {
@@ -77,11 +86,11 @@ update_corpus(GtkWindow *window, VteTerminal *terminal, struct dabbrev_state *st
 		    "terminal");
 		if (other_window == window || other_terminal == NULL) continue;
 
-		corpus = append_corpus(other_terminal, corpus);
+		corpus = append_corpus(other_terminal, state->prefix, corpus);
 	}
 
 	/* Append the current window */
-	state->corpus = append_corpus(terminal, corpus);
+	state->corpus = append_corpus(terminal, state->prefix, corpus);
 	state->corpus_len = strlen(state->corpus);
 	state->current = state->corpus + state->corpus_len;
 }
@@ -213,7 +222,7 @@ dabbrev_expand(GtkWindow *window, VteTerminal *terminal)
 			free(state->prefix);
 			state->prefix = newprefix;
 		}
-		if (!state->prefix || strlen(state->prefix) < TERM_DABBREV_MIN_PREFIX + 1) {
+		if (!state->prefix || strlen(state->prefix) < config_get()->dabbrev_min_prefix + 1) {
 			free(state->prefix);
 			state->prefix = NULL;
 			goto notfound;
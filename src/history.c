@@ -0,0 +1,373 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <zstd.h>
+
+/* VTE keeps a small scrollback (the spool). Rows leaving the screen are
+ * regularly moved from the spool to the history: they are appended to a
+ * pending buffer which, once full, is compressed into a block. Each block
+ * comes with a bitmap of the trigrams it contains to only decompress the
+ * blocks that may contain a given string. When the compressed blocks and
+ * the pending buffers of all terminals exceed the configured size, the
+ * oldest blocks are dropped. Blocks are reference counted so that a
+ * snapshot of them can be decompressed in another thread, even if they
+ * are dropped meanwhile. */
+
+/* Rows kept by VTE until they are archived (they are drained every
+ * HISTORY_DRAIN_DELAY, this only needs to absorb bursts) */
+#define HISTORY_SPOOL 512
+/* Delay between two archivals (in ms) */
+#define HISTORY_DRAIN_DELAY 100
+/* Uncompressed size of a block */
+#define HISTORY_BLOCK_SIZE 16384
+/* Size of the trigram index of a block (in bits) */
+#define HISTORY_INDEX_BITS 16384
+/* zstd compression level */
+#define HISTORY_LEVEL 3
+
+struct history_block {
+	GList *link;		/* Link in the list of all blocks */
+	struct history *history;	/* Owner */
+	guint64 offset;		/* Position of its text in the history */
+	size_t len;		/* Uncompressed length */
+	size_t compressed_len;
+	guint8 index[HISTORY_INDEX_BITS / 8];
+	char data[];		/* Compressed data */
+};
+
+/* Blocks of a terminal which may contain some string */
+struct history_snapshot {
+	GPtrArray *blocks;
+	char *pending;		/* Copy of the pending buffer */
+	guint64 pending_offset;
+	guint64 limit;		/* Text after this position is ignored */
+};
+
+/* Start of the text of an archival */
+struct history_mark {
+	glong row;
+	guint64 offset;
+};
+
+/* Per-terminal state */
+struct history {
+	VteTerminal *terminal;
+	gulong handler;		/* contents-changed handler */
+	gboolean dirty;		/* Waiting for archival */
+	glong archived;		/* First row not archived yet */
+	GQueue blocks;		/* Blocks, oldest first */
+	GString *pending;	/* Block being filled */
+	guint64 length;		/* Length of the text archived so far */
+	GArray *marks;		/* Archivals whose rows may still be spooled */
+};
+
+static GQueue blocks = G_QUEUE_INIT;	/* All blocks, oldest first */
+static GList *dirty = NULL;	/* Terminals waiting for archival */
+static guint drain_source = 0;
+static gsize used = 0;		/* Memory used by blocks and pending buffers */
+static gsize budget = 0;	/* Memory allowed for history */
+
+static guint
+trigram(const char *p)
+{
+	guint h = tolower((unsigned char)p[0]);
+	h = h * 31 + tolower((unsigned char)p[1]);
+	h = h * 31 + tolower((unsigned char)p[2]);
+	return h % HISTORY_INDEX_BITS;
+}
+
+static void
+index_text(guint8 *index, const char *text, size_t len)
+{
+	for (size_t i = 0; i + 2 < len; i++) {
+		guint h = trigram(text + i);
+		index[h / 8] |= 1 << (h % 8);
+	}
+}
+
+/* May the block contain the provided string? */
+static gboolean
+index_match(const struct history_block *block, const char *needle)
+{
+	size_t len = strlen(needle);
+	for (size_t i = 0; i + 2 < len; i++) {
+		guint h = trigram(needle + i);
+		if ((block->index[h / 8] & (1 << (h % 8))) == 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+block_free(struct history_block *block)
+{
+	g_queue_delete_link(&blocks, block->link);
+	g_queue_remove(&block->history->blocks, block);
+	used -= sizeof(*block) + block->compressed_len;
+	g_atomic_rc_box_release(block);
+}
+
+/* Drop oldest blocks until we are within budget */
+static void
+history_evict(void)
+{
+	while (used > budget && !g_queue_is_empty(&blocks))
+		block_free(g_queue_peek_head(&blocks));
+}
+
+/* Compress the pending buffer into a new block */
+static void
+history_seal(struct history *h)
+{
+	GString *pending = h->pending;
+	size_t bound = ZSTD_compressBound(pending->len);
+	char *compressed = g_malloc(bound);
+	size_t len = ZSTD_compress(compressed, bound,
+	    pending->str, pending->len, HISTORY_LEVEL);
+	if (ZSTD_isError(len)) {
+		g_warning("cannot compress history: %s", ZSTD_getErrorName(len));
+		g_free(compressed);
+		g_string_truncate(pending, 0);
+		return;
+	}
+	struct history_block *block = g_atomic_rc_box_alloc0(sizeof(*block) + len);
+	memcpy(block->data, compressed, len);
+	g_free(compressed);
+	block->history = h;
+	block->offset = h->length - pending->len;
+	block->len = pending->len;
+	block->compressed_len = len;
+	index_text(block->index, pending->str, pending->len);
+	g_string_truncate(pending, 0);
+
+	g_queue_push_tail(&h->blocks, block);
+	g_queue_push_tail(&blocks, block);
+	block->link = blocks.tail;
+	used += sizeof(*block) + len;
+	history_evict();
+}
+
+/* Move rows that left the screen from the spool to the history */
+static void
+history_drain(struct history *h)
+{
+	VteTerminal *terminal = h->terminal;
+	GtkAdjustment *adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+	glong first = gtk_adjustment_get_lower(adj);
+	glong top = gtk_adjustment_get_upper(adj) - vte_terminal_get_row_count(terminal);
+
+	if (h->archived < first)
+		h->archived = first;	/* Spool overflowed, rows are lost */
+	if (h->archived >= top)
+		return;
+
+	/* Forget archivals which left the spool */
+	guint gone = 0;
+	while (gone + 1 < h->marks->len &&
+	    g_array_index(h->marks, struct history_mark, gone + 1).row <= first)
+		gone++;
+	g_array_remove_range(h->marks, 0, gone);
+
+	char *text = vte_terminal_get_text_range_format(terminal, VTE_FORMAT_TEXT,
+	    h->archived, 0, top, 0, NULL);
+	struct history_mark mark = { h->archived, h->length };
+	h->archived = top;
+	if (text == NULL)
+		return;
+	g_array_append_val(h->marks, mark);
+	gsize allocated = h->pending->allocated_len;
+	gsize len = strlen(text);
+	g_string_append_len(h->pending, text, len);
+	h->length += len;
+	free(text);
+	used += h->pending->allocated_len - allocated;
+	if (h->pending->len >= HISTORY_BLOCK_SIZE)
+		history_seal(h);
+	else
+		history_evict();
+}
+
+/* Archive all terminals with a single timer */
+static gboolean
+history_drain_all(gpointer user_data)
+{
+	wakeup_dispatch("history");
+	for (GList *l = dirty; l != NULL; l = l->next) {
+		struct history *h = l->data;
+		h->dirty = FALSE;
+		history_drain(h);
+	}
+	g_list_free(dirty);
+	dirty = NULL;
+	drain_source = 0;
+	return G_SOURCE_REMOVE;
+}
+
+static void
+on_contents_changed(VteTerminal *terminal, gpointer user_data)
+{
+	struct history *h = user_data;
+	if (!h->dirty) {
+		h->dirty = TRUE;
+		dirty = g_list_prepend(dirty, h);
+	}
+	if (drain_source == 0)
+		drain_source = g_timeout_add(HISTORY_DRAIN_DELAY,
+		    history_drain_all, NULL);
+}
+
+static void
+history_free(struct history *h)
+{
+	if (h == NULL) return;
+	if (h->dirty)
+		dirty = g_list_remove(dirty, h);
+	while (!g_queue_is_empty(&h->blocks))
+		block_free(g_queue_peek_head(&h->blocks));
+	used -= h->pending->allocated_len;
+	g_string_free(h->pending, TRUE);
+	g_array_unref(h->marks);
+	g_free(h);
+}
+
+/* Enable or disable history according to the configuration */
+void
+history_configure(VteTerminal *terminal)
+{
+	struct history *h = g_object_get_data(G_OBJECT(terminal), "history");
+	budget = (gsize)config_get()->history_size * 1024 * 1024;
+	history_evict();
+
+	if (budget == 0) {
+		if (h == NULL) return;
+		g_signal_handler_disconnect(terminal, h->handler);
+		g_object_set_data(G_OBJECT(terminal), "history", NULL);
+		vte_terminal_set_scrollback_lines(terminal, 0);
+		return;
+	}
+	if (h != NULL) return;
+
+	h = g_new0(struct history, 1);
+	h->terminal = terminal;
+	h->pending = g_string_sized_new(HISTORY_BLOCK_SIZE);
+	used += h->pending->allocated_len;
+	h->marks = g_array_new(FALSE, FALSE, sizeof(struct history_mark));
+	g_queue_init(&h->blocks);
+	vte_terminal_set_scrollback_lines(terminal, HISTORY_SPOOL);
+	h->handler = g_signal_connect(terminal, "contents-changed",
+	    G_CALLBACK(on_contents_changed), h);
+	g_object_set_data_full(G_OBJECT(terminal), "history", h,
+	    (GDestroyNotify)history_free);
+}
+
+/* Position in the history of the first archival whose rows are all still
+ * in the spool. Rows of an archival straddling the start of the spool are
+ * kept on both sides. */
+static guint64
+history_spooled(struct history *h)
+{
+	GtkAdjustment *adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(h->terminal));
+	glong first = gtk_adjustment_get_lower(adj);
+	for (guint i = 0; i < h->marks->len; i++) {
+		struct history_mark *mark = &g_array_index(h->marks, struct history_mark, i);
+		if (mark->row >= first)
+			return mark->offset;
+	}
+	return h->length;
+}
+
+/* Snapshot the history of a terminal, restricted to the blocks that may
+ * contain the provided string. The pending buffer is always included.
+ * Unless requested, the rows still in the spool are left out. Returns
+ * NULL if history is disabled. */
+struct history_snapshot *
+history_snapshot(VteTerminal *terminal, const char *needle, gboolean spooled)
+{
+	struct history *h = g_object_get_data(G_OBJECT(terminal), "history");
+	if (h == NULL) return NULL;
+
+	struct history_snapshot *snapshot = g_new0(struct history_snapshot, 1);
+	snapshot->limit = spooled ? G_MAXUINT64 : history_spooled(h);
+	snapshot->blocks = g_ptr_array_new_with_free_func(g_atomic_rc_box_release);
+	for (GList *l = h->blocks.head; l != NULL; l = l->next) {
+		struct history_block *block = l->data;
+		if (block->offset >= snapshot->limit) break;
+		if (index_match(block, needle))
+			g_ptr_array_add(snapshot->blocks, g_atomic_rc_box_acquire(block));
+	}
+	snapshot->pending = g_strndup(h->pending->str, h->pending->len);
+	snapshot->pending_offset = h->length - h->pending->len;
+	return snapshot;
+}
+
+void
+history_snapshot_free(struct history_snapshot *snapshot)
+{
+	if (snapshot == NULL) return;
+	g_ptr_array_unref(snapshot->blocks);
+	g_free(snapshot->pending);
+	g_free(snapshot);
+}
+
+/* Decompress a snapshot, oldest first. Can be called from any thread.
+ * Returns NULL if there is nothing. */
+char *
+history_snapshot_text(const struct history_snapshot *snapshot)
+{
+	GString *result = g_string_new(NULL);
+	for (guint i = 0; i < snapshot->blocks->len; i++) {
+		const struct history_block *block = snapshot->blocks->pdata[i];
+		gsize offset = result->len;
+		g_string_set_size(result, offset + block->len);
+		size_t len = ZSTD_decompress(result->str + offset, block->len,
+		    block->data, block->compressed_len);
+		if (ZSTD_isError(len) || len != block->len) {
+			g_warning("cannot decompress history: %s",
+			    ZSTD_isError(len) ? ZSTD_getErrorName(len) : "truncated");
+			g_string_truncate(result, offset);
+		} else if (block->offset + len > snapshot->limit)
+			g_string_truncate(result,
+			    offset + (snapshot->limit - block->offset));
+	}
+	if (snapshot->pending_offset < snapshot->limit)
+		g_string_append_len(result, snapshot->pending,
+		    MIN(strlen(snapshot->pending),
+			snapshot->limit - snapshot->pending_offset));
+	if (result->len == 0) {
+		g_string_free(result, TRUE);
+		return NULL;
+	}
+	return g_string_free(result, FALSE);
+}
+
+/* Get the history of a terminal, restricted to the blocks that may
+ * contain the provided string, oldest first. Returns NULL if there is
+ * nothing. */
+char *
+history_text(VteTerminal *terminal, const char *needle)
+{
+	struct history_snapshot *snapshot = history_snapshot(terminal, needle, TRUE);
+	if (snapshot == NULL) return NULL;
+	char *text = history_snapshot_text(snapshot);
+	history_snapshot_free(snapshot);
+	return text;
+}
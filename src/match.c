@@ -0,0 +1,141 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <string.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+
+/* Rules are combined into a single regex, compiled and JIT'ed once for
+ * each set of rules and shared by all terminals using this set. VTE only
+ * runs it on the rows around the pointer when it moves, not on repaint. */
+
+static const struct {
+	const char *name;
+	const char *pattern;
+} rules[] = {
+	{ "url",
+	  "\\b(?:https?|ftps?|file)://"
+	  "[^\\s<>\"'`]*[^\\s<>\"'`.,;:!?)\\]}]" },
+	{ "ip",
+	  "\\b(?:(?:25[0-5]|2[0-4]\\d|1?\\d?\\d)\\.){3}"
+	  "(?:25[0-5]|2[0-4]\\d|1?\\d?\\d)"
+	  "(?:/(?:3[0-2]|[12]?\\d))?\\b" },
+	{ "hash",
+	  "\\b(?=[0-9a-f]*[a-f])(?=[0-9a-f]*\\d)[0-9a-f]{7,64}\\b" },
+	/* Absolute or explicitly relative paths, or file:line */
+	{ "path",
+	  "(?<![\\w.~/])(?:~|\\.{1,2})?(?:/[\\w.+@-]+)+/?(?::\\d+){0,2}"
+	  "|\\b[\\w.+-]+(?:/[\\w.+-]+)*\\.\\w+:\\d+(?::\\d+)?\\b" },
+};
+
+/* Compiled regexes, indexed by set of rules */
+static VteRegex *regexes[1 << G_N_ELEMENTS(rules)];
+
+/* Parse a comma-separated list of rules into a set. */
+gboolean
+match_parse_rules(const gchar *spec, guint *set)
+{
+	gboolean ok = TRUE;
+	gchar **names = g_strsplit(spec, ",", -1);
+	*set = 0;
+	for (gchar **name = names; ok && *name != NULL; name++) {
+		g_strstrip(*name);
+		if (**name == '\0' || !strcmp(*name, "none"))
+			continue;
+		if (!strcmp(*name, "all")) {
+			*set = G_N_ELEMENTS(regexes) - 1;
+			continue;
+		}
+		ok = FALSE;
+		for (guint i = 0; i < G_N_ELEMENTS(rules); i++) {
+			if (!strcmp(*name, rules[i].name)) {
+				*set |= 1 << i;
+				ok = TRUE;
+				break;
+			}
+		}
+	}
+	g_strfreev(names);
+	return ok;
+}
+
+static VteRegex *
+match_regex(guint set)
+{
+	if (regexes[set] != NULL)
+		return regexes[set];
+
+	GString *pattern = g_string_new(NULL);
+	for (guint i = 0; i < G_N_ELEMENTS(rules); i++) {
+		if ((set & (1 << i)) == 0) continue;
+		g_string_append_printf(pattern, "%s(?:%s)",
+		    pattern->len ? "|" : "", rules[i].pattern);
+	}
+
+	GError *error = NULL;
+	VteRegex *regex = vte_regex_new_for_match(pattern->str, pattern->len,
+	    PCRE2_MULTILINE, &error);
+	g_string_free(pattern, TRUE);
+	if (regex == NULL) {
+		g_warning("cannot compile match regex: %s", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	/* VTE does not JIT by itself. Without JIT, we still get the
+	 * interpreter. */
+	vte_regex_jit(regex, PCRE2_JIT_COMPLETE, NULL);
+	vte_regex_jit(regex, PCRE2_JIT_PARTIAL_SOFT, NULL);
+	return regexes[set] = regex;
+}
+
+/* Register the provided set of rules on a terminal. */
+void
+match_setup(VteTerminal *terminal, guint set)
+{
+	VteRegex *regex;
+	if (set == 0 || (regex = match_regex(set)) == NULL)
+		return;
+	int tag = vte_terminal_match_add_regex(terminal, regex, 0);
+	vte_terminal_match_set_cursor_name(terminal, tag, "pointer");
+}
+
+/* Open the URL or copy the text matched under the event. */
+gboolean
+match_activate(GtkWindow *window, VteTerminal *terminal, GdkEvent *event)
+{
+	char *match = vte_terminal_match_check_event(terminal, event, NULL);
+	if (match == NULL) return FALSE;
+
+	GError *error = NULL;
+	if (strstr(match, "://") != NULL) {
+		if (!gtk_show_uri_on_window(window, match,
+			gdk_event_get_time(event), &error)) {
+			g_warning("cannot open %s: %s", match, error->message);
+			g_error_free(error);
+		}
+	} else {
+		gtk_clipboard_set_text(gtk_widget_get_clipboard(GTK_WIDGET(terminal),
+			GDK_SELECTION_CLIPBOARD), match, -1);
+		gtk_clipboard_set_text(gtk_widget_get_clipboard(GTK_WIDGET(terminal),
+			GDK_SELECTION_PRIMARY), match, -1);
+	}
+	g_free(match);
+	return TRUE;
+}
@@ -0,0 +1,400 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+
+/* Search the text of all terminals, including their scrollback and their
+ * history. The text of each terminal is kept until its content changes.
+ * For the history, only the blocks whose index may contain the needle are
+ * decompressed. Each terminal is scanned in a thread pool and its results
+ * are displayed as soon as they are available.
+ *
+ * To jump to a match, VTE is given a regex only matching the line of the
+ * match, at the same position. VTE searches line by line from the top,
+ * so the match is found after skipping the identical lines before it.
+ * Matches in the history cannot be selected as VTE does not have them
+ * anymore. */
+
+/* Maximum number of results for a terminal */
+#define SEARCH_MAX_RESULTS 100
+
+struct search_result {
+	gboolean history;	/* Match in the history */
+	glong row;
+	gsize offset;		/* Position of the match in the line */
+	guint occurrence;	/* Number of identical lines before */
+	char *line;
+};
+
+/* Scan of one terminal */
+struct search_task {
+	guint generation;
+	GtkWindow *window;
+	GBytes *text;
+	struct history_snapshot *history;
+	char *needle;
+	gboolean icase;
+	GPtrArray *results;
+};
+
+static GtkApplication *app = NULL;
+static GtkWidget *search_window = NULL;
+static GtkWidget *entry = NULL;
+static GtkWidget *list = NULL;
+static GThreadPool *pool = NULL;
+static guint generation = 0;	/* Current search */
+
+static void
+search_result_free(struct search_result *result)
+{
+	g_free(result->line);
+	g_free(result);
+}
+
+static void
+search_task_free(struct search_task *task)
+{
+	g_object_unref(task->window);
+	g_bytes_unref(task->text);
+	history_snapshot_free(task->history);
+	g_free(task->needle);
+	g_ptr_array_unref(task->results);
+	g_free(task);
+}
+
+/* Case-insensitive unless there is an uppercase letter */
+static gboolean
+smart_case(const char *needle)
+{
+	for (const char *p = needle; *p; p++)
+		if (g_ascii_isupper(*p)) return FALSE;
+	return TRUE;
+}
+
+static gboolean
+matches_at(const char *p, const char *needle, size_t nlen, gboolean icase)
+{
+	return icase ?
+	    !g_ascii_strncasecmp(p, needle, nlen) :
+	    !memcmp(p, needle, nlen);
+}
+
+/* Find the needle in the haystack. Candidates are found by comparing the
+ * first and the last byte of the needle, 16 positions at once when SSE2
+ * is available. Case is folded by setting 0x20, which may only add
+ * candidates. */
+static const char *
+search_find(const char *hay, size_t len, const char *needle, size_t nlen,
+    gboolean icase)
+{
+	size_t i = 0;
+	if (nlen == 0 || nlen > len) return NULL;
+	guint8 fold = icase ? 0x20 : 0;
+	guint8 first = needle[0] | fold, last = needle[nlen - 1] | fold;
+
+#ifdef __SSE2__
+	const __m128i vfold = _mm_set1_epi8(fold);
+	const __m128i vfirst = _mm_set1_epi8(first);
+	const __m128i vlast = _mm_set1_epi8(last);
+	for (; i + nlen - 1 + 16 <= len; i += 16) {
+		__m128i bfirst = _mm_or_si128(vfold,
+		    _mm_loadu_si128((const __m128i *)(hay + i)));
+		__m128i blast = _mm_or_si128(vfold,
+		    _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1)));
+		guint mask = _mm_movemask_epi8(_mm_and_si128(
+			    _mm_cmpeq_epi8(bfirst, vfirst),
+			    _mm_cmpeq_epi8(blast, vlast)));
+		for (gint bit = -1; (bit = g_bit_nth_lsf(mask, bit)) != -1; ) {
+			if (matches_at(hay + i + bit, needle, nlen, icase))
+				return hay + i + bit;
+		}
+	}
+#endif
+	for (; i + nlen <= len; i++) {
+		if (((guint8)hay[i] | fold) == first &&
+		    matches_at(hay + i, needle, nlen, icase))
+			return hay + i;
+	}
+	return NULL;
+}
+
+/* Count the lines identical to the provided one before it */
+static guint
+count_lines(const char *text, const char *line, gsize len)
+{
+	guint count = 0;
+	const char *p = text, *nl;
+	while (p < line && (nl = memchr(p, '\n', line - p)) != NULL) {
+		if (nl - p == (gssize)len && !memcmp(p, line, len))
+			count++;
+		p = nl + 1;
+	}
+	return count;
+}
+
+static gboolean
+search_deliver(gpointer user_data)
+{
+	struct search_task *task = user_data;
+	wakeup_dispatch("search");
+	if (task->generation != generation ||
+	    g_list_find(gtk_application_get_windows(app), task->window) == NULL)
+		goto end;
+
+	const char *title = gtk_window_get_title(task->window);
+	for (guint i = 0; i < task->results->len; i++) {
+		struct search_result *result = task->results->pdata[i];
+		char *text = result->history ?
+		    g_strdup_printf("%s:history: %s", title ?: PACKAGE_NAME,
+			result->line) :
+		    g_strdup_printf("%s:%ld: %s", title ?: PACKAGE_NAME,
+			result->row + 1, result->line);
+		GtkWidget *label = gtk_label_new(text);
+		g_free(text);
+		gtk_label_set_xalign(GTK_LABEL(label), 0);
+		gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+
+		GtkWidget *row = gtk_list_box_row_new();
+		gtk_container_add(GTK_CONTAINER(row), label);
+		g_object_set_data_full(G_OBJECT(row), "window",
+		    g_object_ref(task->window), g_object_unref);
+		if (!result->history)
+			g_object_set_data_full(G_OBJECT(row), "line",
+			    g_strdup(result->line), g_free);
+		g_object_set_data(G_OBJECT(row), "offset",
+		    GSIZE_TO_POINTER(result->offset));
+		g_object_set_data(G_OBJECT(row), "length",
+		    GSIZE_TO_POINTER(strlen(task->needle)));
+		g_object_set_data(G_OBJECT(row), "occurrence",
+		    GUINT_TO_POINTER(result->occurrence));
+		gtk_widget_show_all(row);
+		gtk_container_add(GTK_CONTAINER(list), row);
+	}
+end:
+	search_task_free(task);
+	return G_SOURCE_REMOVE;
+}
+
+/* Scan some text of a terminal */
+static void
+search_scan(struct search_task *task, const char *text, gsize len,
+    gboolean history)
+{
+	gsize nlen = strlen(task->needle);
+	const char *end = text + len;
+	const char *line = text, *p = text, *match, *nl;
+	glong row = 0;
+
+	while (task->results->len < SEARCH_MAX_RESULTS &&
+	    (match = search_find(p, end - p, task->needle, nlen, task->icase)) != NULL) {
+		while ((nl = memchr(line, '\n', match - line)) != NULL) {
+			line = nl + 1;
+			row++;
+		}
+		struct search_result *result = g_new0(struct search_result, 1);
+		nl = memchr(match, '\n', end - match);
+		result->history = history;
+		result->row = row;
+		result->offset = match - line;
+		if (!history)
+			result->occurrence = count_lines(text, line, (nl ?: end) - line);
+		result->line = g_strndup(line, (nl ?: end) - line);
+		g_ptr_array_add(task->results, result);
+		p = match + nlen;
+	}
+}
+
+/* Scan a terminal (in a worker thread), most recent text first */
+static void
+search_run(gpointer data, gpointer user_data)
+{
+	struct search_task *task = data;
+	gsize len;
+	const char *text = g_bytes_get_data(task->text, &len);
+	search_scan(task, text, len, FALSE);
+
+	char *history;
+	if (task->history != NULL &&
+	    (history = history_snapshot_text(task->history)) != NULL) {
+		search_scan(task, history, strlen(history), TRUE);
+		g_free(history);
+	}
+	g_idle_add_full(G_PRIORITY_DEFAULT, search_deliver, task, NULL);
+}
+
+/* Whole text of a terminal, kept until its content changes */
+static GBytes *
+search_text(VteTerminal *terminal)
+{
+	GBytes *text = g_object_get_data(G_OBJECT(terminal), "search-text");
+	if (text == NULL) {
+		GtkAdjustment *adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+		char *content = vte_terminal_get_text_range_format(terminal,
+		    VTE_FORMAT_TEXT, gtk_adjustment_get_lower(adj), 0,
+		    gtk_adjustment_get_upper(adj), 0, NULL);
+		text = g_bytes_new_take(content, content ? strlen(content) : 0);
+		g_object_set_data_full(G_OBJECT(terminal), "search-text", text,
+		    (GDestroyNotify)g_bytes_unref);
+	}
+	return g_bytes_ref(text);
+}
+
+static void
+on_search_changed(GtkSearchEntry *widget, gpointer user_data)
+{
+	const char *needle = gtk_entry_get_text(GTK_ENTRY(widget));
+	gboolean icase = smart_case(needle);
+
+	generation++;
+	gtk_container_foreach(GTK_CONTAINER(list), (GtkCallback)gtk_widget_destroy, NULL);
+	if (*needle == '\0') return;
+
+	for (GList *windows = gtk_application_get_windows(app);
+	     windows;
+	     windows = windows->next) {
+		VteTerminal *terminal = g_object_get_data(G_OBJECT(windows->data),
+		    "terminal");
+		if (terminal == NULL) continue;
+
+		struct search_task *task = g_new(struct search_task, 1);
+		task->generation = generation;
+		task->window = g_object_ref(windows->data);
+		task->text = search_text(terminal);
+		task->history = history_snapshot(terminal, needle, FALSE);
+		task->needle = g_strdup(needle);
+		task->icase = icase;
+		task->results = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)search_result_free);
+		g_thread_pool_push(pool, task, NULL);
+	}
+}
+
+/* Raise the window and select the match */
+static void
+on_row_activated(GtkListBox *box, GtkListBoxRow *row, gpointer user_data)
+{
+	GtkWindow *window = g_object_get_data(G_OBJECT(row), "window");
+	const char *line = g_object_get_data(G_OBJECT(row), "line");
+	gsize offset = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(row),
+		"offset"));
+	gsize nlen = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(row),
+		"length"));
+	guint occurrence = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(row),
+		"occurrence"));
+	if (g_list_find(gtk_application_get_windows(app), window) == NULL)
+		return;
+	VteTerminal *terminal = g_object_get_data(G_OBJECT(window), "terminal");
+
+	gtk_widget_hide(search_window);
+	gtk_window_present(window);
+	if (line == NULL) return;	/* In the history */
+
+	/* ^before\Kmatch(?=after$) */
+	char *before = g_regex_escape_string(line, offset);
+	char *match = g_regex_escape_string(line + offset, nlen);
+	char *after = g_regex_escape_string(line + offset + nlen, -1);
+	char *pattern = g_strdup_printf("^%s\\K%s(?=%s$)", before, match, after);
+	VteRegex *regex = vte_regex_new_for_search(pattern, -1,
+	    PCRE2_MULTILINE, NULL);
+	g_free(before);
+	g_free(match);
+	g_free(after);
+	g_free(pattern);
+	if (regex == NULL) return;
+	vte_terminal_search_set_regex(terminal, regex, 0);
+	vte_regex_unref(regex);
+
+	/* Search from the top */
+	GtkAdjustment *adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+	gtk_adjustment_set_value(adj, gtk_adjustment_get_lower(adj));
+	vte_terminal_unselect_all(terminal);
+	for (guint i = 0; i <= occurrence; i++)
+		vte_terminal_search_find_next(terminal);
+}
+
+static void
+on_search_activate(GtkEntry *widget, gpointer user_data)
+{
+	GtkListBoxRow *row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(list), 0);
+	if (row != NULL)
+		on_row_activated(GTK_LIST_BOX(list), row, NULL);
+}
+
+static void
+on_stop_search(GtkSearchEntry *widget, gpointer user_data)
+{
+	gtk_widget_hide(search_window);
+}
+
+static void
+on_terminal_changed(VteTerminal *terminal, gpointer user_data)
+{
+	g_object_set_data(G_OBJECT(terminal), "search-text", NULL);
+}
+
+/* Make a terminal searchable */
+void
+search_setup(VteTerminal *terminal)
+{
+	g_signal_connect(terminal, "contents-changed",
+	    G_CALLBACK(on_terminal_changed), NULL);
+}
+
+/* Display the search window */
+void
+search_show(GtkApplication *application)
+{
+	if (search_window == NULL) {
+		app = application;
+		pool = g_thread_pool_new(search_run, NULL,
+		    g_get_num_processors(), FALSE, NULL);
+
+		search_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+		gtk_window_set_title(GTK_WINDOW(search_window), PACKAGE_NAME);
+		gtk_window_set_default_size(GTK_WINDOW(search_window), 800, 400);
+		GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+		entry = gtk_search_entry_new();
+		GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+		list = gtk_list_box_new();
+		gtk_container_add(GTK_CONTAINER(scrolled), list);
+		gtk_box_pack_start(GTK_BOX(box), entry, FALSE, FALSE, 0);
+		gtk_box_pack_start(GTK_BOX(box), scrolled, TRUE, TRUE, 0);
+		gtk_container_add(GTK_CONTAINER(search_window), box);
+
+		g_signal_connect(search_window, "delete-event",
+		    G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+		g_signal_connect(entry, "search-changed",
+		    G_CALLBACK(on_search_changed), NULL);
+		g_signal_connect(entry, "activate",
+		    G_CALLBACK(on_search_activate), NULL);
+		g_signal_connect(entry, "stop-search",
+		    G_CALLBACK(on_stop_search), NULL);
+		g_signal_connect(list, "row-activated",
+		    G_CALLBACK(on_row_activated), NULL);
+		gtk_widget_show_all(box);
+	}
+	gtk_window_present(GTK_WINDOW(search_window));
+	gtk_widget_grab_focus(entry);
+}
@@ -47,7 +47,7 @@ static void
 reset_font_size(VteTerminal *terminal)
 {
 	PangoFontDescription *descr;
-	if ((descr = pango_font_description_from_string(TERM_FONT)) == NULL)
+	if ((descr = pango_font_description_from_string(config_get()->font)) == NULL)
 		return;
 	vte_terminal_set_font(terminal, descr);
 	pango_font_description_free(descr);
@@ -100,6 +100,15 @@ on_window_focus(GtkWidget *widget, GdkEvent *event, gpointer user_data)
 {
 	GtkWindow *window = user_data;
 	gtk_window_set_urgency_hint(window, FALSE);
+	cgroup_focus(window, TRUE);
+	return FALSE;
+}
+
+static gboolean
+on_window_unfocus(GtkWidget *widget, GdkEvent *event, gpointer user_data)
+{
+	GtkWindow *window = user_data;
+	cgroup_focus(window, FALSE);
 	return FALSE;
 }
 
@@ -122,6 +131,9 @@ on_key_press(GtkWidget *terminal, GdkEventKey *event, gpointer user_data)
 		case GDK_KEY_V:
 			vte_terminal_paste_clipboard(VTE_TERMINAL(terminal));
 			return TRUE;
+		case GDK_KEY_F:
+			search_show(gtk_window_get_application(GTK_WINDOW(user_data)));
+			return TRUE;
 		}
 		/* fallthrough */
 	case GDK_CONTROL_MASK:
@@ -158,6 +170,16 @@ on_key_press(GtkWidget *terminal, GdkEventKey *event, gpointer user_data)
 	return FALSE;
 }
 
+static gboolean
+on_button_press(GtkWidget *terminal, GdkEventButton *event, gpointer user_data)
+{
+	if (event->type != GDK_BUTTON_PRESS || event->button != 1 ||
+	    (event->state & GDK_CONTROL_MASK) == 0)
+		return FALSE;
+	return match_activate(GTK_WINDOW(user_data), VTE_TERMINAL(terminal),
+	    (GdkEvent *)event);
+}
+
 static gchar**
 get_child_environment(GApplicationCommandLine *cmdline)
 {
@@ -181,11 +203,43 @@ static void
 child_ready(VteTerminal *terminal, GPid pid, GError *error, gpointer user_data)
 {
 	if (!terminal) return;
+	GtkWindow *window = user_data;
 	if (pid == -1) {
-		GtkWindow *window = user_data;
 		terminate(window, error->code);
 		g_error_free(error);
+		return;
 	}
+	cgroup_attach(window, pid);
+	wakeup_watch(terminal, pid);
+}
+
+#define CLR_R(x)       (((x) & 0xff0000) >> 16)
+#define CLR_G(x)       (((x) & 0x00ff00) >>  8)
+#define CLR_B(x)       (((x) & 0x0000ff) >>  0)
+#define CLR_16(x)      ((double)(x) / 0xff)
+#define CLR_GDKA(x, a) (const GdkRGBA){ .red = CLR_16(CLR_R(x)), .green = CLR_16(CLR_G(x)), .blue = CLR_16(CLR_B(x)), .alpha = a }
+#define CLR_GDK(x)     CLR_GDKA(x, 0)
+
+/* Apply the current configuration to a terminal */
+void
+terminal_configure(VteTerminal *terminal, gboolean reset_font)
+{
+	const struct term_config *config = config_get();
+	GdkRGBA fg = CLR_GDK(config->foreground);
+	GdkRGBA bg = CLR_GDKA(config->background, config->opacity);
+	GdkRGBA palette[256];
+	for (int i = 0; i < 16; i++)
+		palette[i] = CLR_GDK(config->palette[i]);
+	generate_palette(palette, &bg, &fg);
+	vte_terminal_set_colors(terminal,
+	    &fg, &bg, palette, 256);
+	vte_terminal_set_color_cursor(terminal,
+	    &CLR_GDK(config->cursor));
+	vte_terminal_set_word_char_exceptions(terminal,
+	    config->word_chars);
+	if (reset_font)
+		reset_font_size(terminal);
+	history_configure(terminal);
 }
 
 static void
@@ -247,15 +301,15 @@ command_line(GApplication *app, GApplicationCommandLine *cmdline, gpointer user_
 	/* Connect some signals */
 	g_signal_connect(window, "delete-event", G_CALLBACK(on_window_close), NULL);
 	g_signal_connect(window, "focus-in-event", G_CALLBACK(on_window_focus), GTK_WINDOW(window));
+	g_signal_connect(window, "focus-out-event", G_CALLBACK(on_window_unfocus), GTK_WINDOW(window));
 	g_signal_connect(terminal, "bell", G_CALLBACK(on_bell), GTK_WINDOW(window));
 	g_signal_connect(terminal, "child-exited", G_CALLBACK(on_child_exit), GTK_WINDOW(window));
 	g_signal_connect(terminal, "termprop-changed::" VTE_TERMPROP_XTERM_TITLE, G_CALLBACK(on_title_changed), GTK_WINDOW(window));
 	g_signal_connect(terminal, "key-press-event", G_CALLBACK(on_key_press), GTK_WINDOW(window));
+	g_signal_connect(terminal, "button-press-event", G_CALLBACK(on_button_press), GTK_WINDOW(window));
 	g_signal_connect(terminal, "char-size-changed", G_CALLBACK(on_char_size_changed), NULL);
 
 	/* Configure terminal */
-	vte_terminal_set_word_char_exceptions(VTE_TERMINAL(terminal),
-	    TERM_WORD_CHARS);
 	vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal),
 	    0);
 	vte_terminal_set_scroll_on_output(VTE_TERMINAL(terminal),
@@ -265,48 +319,29 @@ command_line(GApplication *app, GApplicationCommandLine *cmdline, gpointer user_
 	vte_terminal_set_mouse_autohide(VTE_TERMINAL(terminal),
 	    TRUE);
 
-#define CLR_R(x)       (((x) & 0xff0000) >> 16)
-#define CLR_G(x)       (((x) & 0x00ff00) >>  8)
-#define CLR_B(x)       (((x) & 0x0000ff) >>  0)
-#define CLR_16(x)      ((double)(x) / 0xff)
-#define CLR_GDKA(x, a) (const GdkRGBA){ .red = CLR_16(CLR_R(x)), .green = CLR_16(CLR_G(x)), .blue = CLR_16(CLR_B(x)), .alpha = a }
-#define CLR_GDK(x)     CLR_GDKA(x, 0)
-
-	GdkRGBA fg = CLR_GDK(0xffffff);
-	GdkRGBA bg = CLR_GDKA(0x0c0000, TERM_OPACITY);
-	GdkRGBA palette[256] = {
-		CLR_GDK(0x111111),
-		CLR_GDK(0xd36265),
-		CLR_GDK(0xaece91),
-		CLR_GDK(0xe7e18c),
-		CLR_GDK(0x5297cf),
-		CLR_GDK(0xde7fa8),
-		CLR_GDK(0x5e7175),
-		CLR_GDK(0xbebebe),
-		CLR_GDK(0x555555),
-		CLR_GDK(0xef8171),
-		CLR_GDK(0xcfefb3),
-		CLR_GDK(0xfff796),
-		CLR_GDK(0x74b8ef),
-		CLR_GDK(0xe393b6),
-		CLR_GDK(0xa3babf),
-		CLR_GDK(0xdddddd),
-		/* 240 elements remaining */
-	};
-	generate_palette(palette, &bg, &fg);
-	vte_terminal_set_colors(VTE_TERMINAL(terminal),
-	    &fg, &bg, palette, 256);
 	vte_terminal_set_bold_is_bright(VTE_TERMINAL(terminal),
 	    TRUE);
-	vte_terminal_set_color_cursor(VTE_TERMINAL(terminal),
-	    &CLR_GDK(0x00bb00));
 	vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(terminal),
 	    VTE_CURSOR_BLINK_OFF);
-	reset_font_size(VTE_TERMINAL(terminal));
+	vte_terminal_set_text_blink_mode(VTE_TERMINAL(terminal),
+	    VTE_TEXT_BLINK_FOCUSED);
+	terminal_configure(VTE_TERMINAL(terminal), TRUE);
 
 	vte_terminal_set_audible_bell(VTE_TERMINAL(terminal),
 	    FALSE);
 
+	/* Clickable matches */
+	const gchar *match = TERM_MATCH_RULES;
+	guint rules = 0;
+	g_variant_dict_lookup(options, "match", "&s", &match);
+	if (!match_parse_rules(match, &rules)) {
+		g_application_command_line_printerr(cmdline,
+		    "invalid match rules: %s\n", match);
+		match_parse_rules(TERM_MATCH_RULES, &rules);
+	}
+	match_setup(VTE_TERMINAL(terminal), rules);
+	search_setup(VTE_TERMINAL(terminal));
+
 	/* Start a new shell */
 	const gchar *cmd = NULL;
 	g_variant_dict_lookup(options, "command", "&s", &cmd);
@@ -314,20 +349,37 @@ command_line(GApplication *app, GApplicationCommandLine *cmdline, gpointer user_
 	gchar **env;
 	env = get_child_environment(cmdline);
 
+	/* Isolate the child in its own cgroup */
+	gboolean cgroup = FALSE;
+	gint cpu_weight = TERM_CPU_WEIGHT;
+	guint64 memory_max = 0;
+	const gchar *memory = NULL;
+	g_variant_dict_lookup(options, "cgroup", "b", &cgroup);
+	cgroup |= g_variant_dict_lookup(options, "cpu-weight", "i", &cpu_weight);
+	cgroup |= g_variant_dict_lookup(options, "memory-max", "&s", &memory);
+	if (memory != NULL && !cgroup_parse_size(memory, &memory_max))
+		g_application_command_line_printerr(cmdline,
+		    "invalid memory size: %s\n", memory);
+	if (cgroup)
+		cgroup = cgroup_new(GTK_WINDOW(window), cpu_weight, memory_max);
+
 	gchar **command;
 	gchar *command0 = NULL;
 	command = cmd ?
 	    (gchar *[]){"/bin/sh", "-c", command0 = g_strdup(cmd), NULL} :
 	    (gchar *[]){command0 = g_strdup(g_application_command_line_getenv(cmdline, "SHELL")),
 		    NULL};
+	gchar **wrapped = cgroup ? cgroup_command(GTK_WINDOW(window), command) : NULL;
 
 	vte_terminal_spawn_async(VTE_TERMINAL(terminal),
 	    VTE_PTY_DEFAULT,
 	    g_application_command_line_get_cwd(cmdline), /* working directory */
-	    command,
+	    wrapped ? wrapped : command,
 	    env,		/* envv */
-	    0,			/* spawn flags */
-	    NULL, NULL, NULL,	/* child setup */
+	    wrapped ? G_SPAWN_SEARCH_PATH : 0,	/* spawn flags */
+	    cgroup ? cgroup_child_setup : NULL,	/* child setup */
+	    cgroup ? cgroup_child_data(GTK_WINDOW(window)) : NULL,
+	    NULL,
 	    -1,			/* timeout */
 	    NULL,		/* cancellable */
 	    child_ready,	/* callback */
@@ -335,6 +387,7 @@ command_line(GApplication *app, GApplicationCommandLine *cmdline, gpointer user_
 	/* Safe to free as those variables are g_strdupv() early in
 	 * async_spawn_data_new() */
 	g_strfreev(env);
+	g_strfreev(wrapped);
 	g_free(command0);
 }
 
@@ -345,6 +398,8 @@ main(int argc, char *argv[])
 	gint status;
 	app = gtk_application_new("ch.bernat.Terminal8",
 	    G_APPLICATION_HANDLES_COMMAND_LINE | G_APPLICATION_SEND_ENVIRONMENT);
+	g_signal_connect(app, "startup", G_CALLBACK(config_init), NULL);
+	g_signal_connect(app, "startup", G_CALLBACK(wakeup_init), NULL);
 	g_signal_connect(app, "command-line", G_CALLBACK(command_line), NULL);
 	g_application_add_main_option_entries(G_APPLICATION(app),
 	    (const GOptionEntry[]){
@@ -357,6 +412,18 @@ main(int argc, char *argv[])
 		    { "command", 'e', 0,  G_OPTION_ARG_STRING, NULL,
 				"Execute the argument to this option inside the terminal",
 				"CMD" },
+		    { "match", 0, 0, G_OPTION_ARG_STRING, NULL,
+				"Comma-separated list of clickable matches (url, ip, hash, path, all, none)",
+				"RULES" },
+		    { "cgroup", 0, 0, G_OPTION_ARG_NONE, NULL,
+				"Run the child in its own cgroup",
+				NULL },
+		    { "cpu-weight", 0, 0, G_OPTION_ARG_INT, NULL,
+				"CPU weight of the child cgroup (implies --cgroup)",
+				"WEIGHT" },
+		    { "memory-max", 0, 0, G_OPTION_ARG_STRING, NULL,
+				"Memory limit of the child cgroup (implies --cgroup)",
+				"SIZE" },
 		    { NULL }
 	    });
 	status = g_application_run(G_APPLICATION(app), argc, argv);
@@ -24,6 +24,8 @@
 
 #include <vte/vte.h>
 
+/* Defaults for the configuration file */
+
 /* Non alphanumeric characters we consider part of a word. */
 #define TERM_WORD_CHARS "-./?%&_=+@~:"
 /* Minimum prefix to try completing a word. */
@@ -32,9 +34,51 @@
 #define TERM_OPACITY 0.9
 /* Terminal font */
 #define TERM_FONT "Iosevka Term SS18 10"
+/* Memory for compressed history of all terminals (in MiB, 0 to disable) */
+#define TERM_HISTORY_SIZE 0
+/* Default CPU weight of a terminal cgroup */
+#define TERM_CPU_WEIGHT 100
+/* Clickable matches (url, ip, hash, path, all or none) */
+#define TERM_MATCH_RULES "all"
+
+/* Runtime configuration. Also the layout of the configuration cache. */
+struct term_config {
+	char font[128];
+	char word_chars[64];
+	double opacity;
+	guint dabbrev_min_prefix;
+	guint history_size;
+	guint32 foreground;
+	guint32 background;
+	guint32 cursor;
+	guint32 palette[16];
+};
 
+void terminal_configure(VteTerminal *, gboolean);
+void config_init(GApplication *, gpointer);
+const struct term_config *config_get(void);
 gboolean dabbrev_expand(GtkWindow *, VteTerminal *);
 void dabbrev_stop(VteTerminal *);
 void generate_palette(GdkRGBA *, const GdkRGBA *, const GdkRGBA *);
+void history_configure(VteTerminal *);
+char *history_text(VteTerminal *, const char *);
+struct history_snapshot *history_snapshot(VteTerminal *, const char *, gboolean);
+char *history_snapshot_text(const struct history_snapshot *);
+void history_snapshot_free(struct history_snapshot *);
+void search_setup(VteTerminal *);
+void search_show(GtkApplication *);
+void wakeup_init(GApplication *, gpointer);
+void wakeup_watch(VteTerminal *, GPid);
+void wakeup_dispatch(const char *);
+gboolean cgroup_parse_size(const gchar *, guint64 *);
+gboolean cgroup_new(GtkWindow *, gint, guint64);
+gpointer cgroup_child_data(GtkWindow *);
+void cgroup_child_setup(gpointer);
+gchar **cgroup_command(GtkWindow *, gchar **);
+void cgroup_attach(GtkWindow *, GPid);
+void cgroup_focus(GtkWindow *, gboolean);
+gboolean match_parse_rules(const gchar *, guint *);
+void match_setup(VteTerminal *, guint);
+gboolean match_activate(GtkWindow *, VteTerminal *, GdkEvent *);
 
 #endif
@@ -0,0 +1,204 @@
+/* -*- mode: c; c-file-style: "openbsd" -*- */
+/*
+ * Copyright (c) 2026 Vincent Bernat <bernat@luffy.cx>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "term.h"
+
+#include <stdlib.h>
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#endif
+
+/* When VBETERM_WAKEUP_STATS is set to a number of seconds, wakeups of the
+ * main loop are counted and reported at this interval. Only polls which
+ * could have slept count as wakeups. A wakeup is attributed to the file
+ * descriptors which are ready (the pty of a terminal, the display
+ * connection). When none are, a timer expired: the wakeup is attributed
+ * to the first of our sources dispatched or of the terminals emitting
+ * contents-changed, cursor-moved or draw before the main loop sleeps
+ * again, along with the name of the source being dispatched then. Other
+ * timer wakeups are only counted as "timer". Dispatches of our own
+ * sources are also counted, but not those of VTE or GTK. */
+
+#define WAKEUP_ENV "VBETERM_WAKEUP_STATS"
+
+static guint interval = 0;	/* Reporting interval (0 = disabled) */
+static GHashTable *fds = NULL;	/* fd -> name */
+static GHashTable *counts = NULL;	/* name -> count */
+static guint wakeups = 0;
+static gboolean timer = FALSE;	/* Timer wakeup not attributed yet */
+
+static void
+wakeup_count(const char *name)
+{
+	guint count = GPOINTER_TO_UINT(g_hash_table_lookup(counts, name));
+	g_hash_table_replace(counts, g_strdup(name), GUINT_TO_POINTER(count + 1));
+}
+
+/* Attribute a pending timer wakeup to the provided owner */
+static void
+wakeup_attribute(const char *owner)
+{
+	if (!timer) return;
+	timer = FALSE;
+	GSource *source = g_main_current_source();
+	const char *name = source ? g_source_get_name(source) : NULL;
+	char *bucket = name ?
+	    g_strdup_printf("timer %s (%s)", owner, name) :
+	    g_strdup_printf("timer %s", owner);
+	wakeup_count(bucket);
+	g_free(bucket);
+}
+
+static gint
+wakeup_poll(GPollFD *ufds, guint nfds, gint timeout)
+{
+	if (timer && timeout != 0) {
+		/* Nobody claimed the previous timer wakeup */
+		timer = FALSE;
+		wakeup_count("timer");
+	}
+	gint ready = g_poll(ufds, nfds, timeout);
+	if (timeout == 0 || ready < 0)
+		return ready;	/* Not a wakeup */
+	wakeups++;
+	if (ready == 0) {
+		timer = TRUE;
+		return ready;
+	}
+	for (guint i = 0; i < nfds; i++) {
+		if (ufds[i].revents == 0) continue;
+		const char *name = g_hash_table_lookup(fds,
+		    GINT_TO_POINTER(ufds[i].fd));
+		if (name != NULL) {
+			wakeup_count(name);
+		} else {
+			char unknown[16];
+			g_snprintf(unknown, sizeof(unknown), "fd %d", ufds[i].fd);
+			wakeup_count(unknown);
+		}
+	}
+	return ready;
+}
+
+static gint
+compare_counts(gconstpointer a, gconstpointer b)
+{
+	guint ca = GPOINTER_TO_UINT(g_hash_table_lookup(counts, *(const char **)a));
+	guint cb = GPOINTER_TO_UINT(g_hash_table_lookup(counts, *(const char **)b));
+	return (ca < cb) - (ca > cb);
+}
+
+static gboolean
+wakeup_report(gpointer user_data)
+{
+	guint n;
+	gchar **names;
+	GString *details = g_string_new(NULL);
+
+	wakeup_dispatch("wakeup-stats");
+	names = (gchar **)g_hash_table_get_keys_as_array(counts, &n);
+	qsort(names, n, sizeof(gchar *), compare_counts);
+	for (guint i = 0; i < n; i++) {
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(counts, names[i]));
+		g_string_append_printf(details, " %s=%.1f",
+		    names[i], (double)count / interval);
+	}
+	g_message("%.1f wakeups/s:%s", (double)wakeups / interval, details->str);
+	g_free(names);
+	g_string_free(details, TRUE);
+
+	g_hash_table_remove_all(counts);
+	wakeups = 0;
+	return G_SOURCE_CONTINUE;
+}
+
+/* Count a dispatch of one of our sources */
+void
+wakeup_dispatch(const char *subsystem)
+{
+	if (interval == 0) return;
+	wakeup_attribute(subsystem);
+	char *name = g_strdup_printf("dispatch %s", subsystem);
+	wakeup_count(name);
+	g_free(name);
+}
+
+static void
+wakeup_unwatch(int *fd)
+{
+	g_hash_table_remove(fds, GINT_TO_POINTER(*fd));
+	g_free(fd);
+}
+
+static void
+on_terminal_activity(VteTerminal *terminal, gpointer user_data)
+{
+	wakeup_attribute(g_object_get_data(G_OBJECT(terminal), "wakeup-name"));
+}
+
+static gboolean
+on_terminal_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	on_terminal_activity(VTE_TERMINAL(widget), user_data);
+	return FALSE;
+}
+
+/* Attribute wakeups of the pty of a terminal and of its timers to it */
+void
+wakeup_watch(VteTerminal *terminal, GPid pid)
+{
+	VtePty *pty;
+	if (interval == 0 || (pty = vte_terminal_get_pty(terminal)) == NULL)
+		return;
+	char *name = g_strdup_printf("pty %d", pid);
+	int *fd = g_new(int, 1);
+	*fd = vte_pty_get_fd(pty);
+	g_hash_table_replace(fds, GINT_TO_POINTER(*fd), g_strdup(name));
+	g_object_set_data_full(G_OBJECT(terminal), "wakeup-fd", fd,
+	    (GDestroyNotify)wakeup_unwatch);
+	g_object_set_data_full(G_OBJECT(terminal), "wakeup-name", name, g_free);
+	g_signal_connect(terminal, "contents-changed",
+	    G_CALLBACK(on_terminal_activity), NULL);
+	g_signal_connect(terminal, "cursor-moved",
+	    G_CALLBACK(on_terminal_activity), NULL);
+	g_signal_connect(terminal, "draw",
+	    G_CALLBACK(on_terminal_draw), NULL);
+}
+
+void
+wakeup_init(GApplication *app, gpointer user_data)
+{
+	const char *env = getenv(WAKEUP_ENV);
+	gint seconds;
+	if (env == NULL || (seconds = atoi(env)) <= 0)
+		return;
+	interval = seconds;
+
+	fds = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+	counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+#ifdef GDK_WINDOWING_X11
+	GdkDisplay *gdisplay = gdk_display_get_default();
+	if (gdisplay != NULL && GDK_IS_X11_DISPLAY(gdisplay)) {
+		Display *xdisplay = gdk_x11_display_get_xdisplay(gdisplay);
+		g_hash_table_replace(fds, GINT_TO_POINTER(ConnectionNumber(xdisplay)),
+		    g_strdup("display"));
+	}
+#endif
+	g_main_context_set_poll_func(NULL, wakeup_poll);
+	g_timeout_add_seconds(interval, wakeup_report, NULL);
+}